@@ -1,11 +1,50 @@
 #include <iostream> // For basic input/output
 #include <cstdlib>  // For random numbers
-#include <string>   // Because strings
+#include <fstream>  // For saving and loading games
+#include <cstdio>   // For std::rename and std::remove
+#include <ctime>    // For seeding the random numbers
+#include <cctype>   // For isspace and tolower
+#include <unistd.h> // For telling a terminal apart from a piped script
+#include <new>      // For counting heap allocations (COUNT_ALLOCATIONS)
 
 #define BLACKJACK 22 // Greater than a 21
 #define BUSTED -1
 #define SURRENDER -2
 #define N_CARDS 52
+#define SAVE_FILE "blackjack.sav"
+#define SAVE_VERSION 1
+#define MAX_SAVED_BANK_ACCOUNT 100000000 // Sanity limit on bank accounts read from a save
+#define INPUT_BUFFER 64 // Longest token or line of input we care about. The rest is discarded
+
+// Results of parsing a bet
+#define BET_OK 0
+#define BET_NOT_A_NUMBER 1
+#define BET_NOT_WHOLE 2
+
+/*
+Compile with -DCOUNT_ALLOCATIONS to print how many heap allocations each round makes.
+Used for testing that a round does not allocate. Run it from a script (so the game does not save, which allocates)
+*/
+#ifdef COUNT_ALLOCATIONS
+long n_allocations = 0;
+
+void *operator new(std::size_t size) {
+    n_allocations++;
+    void *ptr = std::malloc((size == 0) ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#endif
 
 struct card {
     int suit;
@@ -60,8 +99,16 @@ struct player {
     int bet_list[16];
     card starting_hand[2];
     int n_splits = 0;
+    int insurance_bet = 0;  // Side bet against a dealer blackjack when the dealer shows an ace
+    bool took_even_money = false; // The blackjack in the first hand was paid out before the turns
 };
 
+// What the running game is checkpointed with (see save_game). Set up by main, save_players stays null when nothing is saved
+player *save_players = nullptr;
+unsigned int save_seed = 0;
+int save_round = 0;
+void checkpoint(void); // Defined next to save_game, but bets are placed long before that
+
 void player_init(player players[5]) {
     // Just sets the dealer and the player IDs
     players[0].isDealer = true;
@@ -71,36 +118,155 @@ void player_init(player players[5]) {
 }
 
 
+/*
+Input handling
+All input goes through fixed-size buffers, so reading a prompt never allocates or throws.
+This also lets the game be driven by a piped file of decisions (see main)
+*/
+
+void end_of_input(void) {
+    // Runs out of input in the middle of a round. Only happens when the game is fed from a script
+    std::cout << "No more input. Goodbye.\n";
+    std::exit(0);
+}
+
+int skip_whitespace(void) {
+    /*
+    Flushes the pending prompt, then skips whitespace in std::cin and returns the next character (or EOF)
+    Reading straight from the buffer bypasses the flush std::cin normally does on its tied std::cout
+    */
+    if (std::cin.tie() != nullptr) {
+        std::cin.tie()->flush();
+    }
+    int c = std::cin.rdbuf()->sgetc();
+    while (c != EOF && isspace(c)) {
+        c = std::cin.rdbuf()->snextc();
+    }
+    return c;
+}
+
+bool read_token(char buf[INPUT_BUFFER]) {
+    /*
+    Reads the next whitespace-separated word into buf
+    Characters beyond INPUT_BUFFER - 1 are discarded. Returns false at the end of the input
+    */
+    int c = skip_whitespace();
+    if (c == EOF) {
+        std::cin.setstate(std::ios::eofbit);
+        return false;
+    }
+
+    int len = 0;
+    while (c != EOF && !isspace(c)) {
+        if (len < INPUT_BUFFER - 1) {
+            buf[len] = c;
+            len++;
+        }
+        c = std::cin.rdbuf()->snextc();
+    }
+    buf[len] = '\0';
+    return true;
+}
+
+bool read_line(char buf[INPUT_BUFFER]) {
+    /*
+    Skips blank space, then reads the rest of the line into buf (trailing spaces removed)
+    Characters beyond INPUT_BUFFER - 1 are discarded. Returns false at the end of the input
+    */
+    int c = skip_whitespace();
+    if (c == EOF) {
+        std::cin.setstate(std::ios::eofbit);
+        return false;
+    }
+
+    int len = 0;
+    while (c != EOF && c != '\n') {
+        if (len < INPUT_BUFFER - 1) {
+            buf[len] = c;
+            len++;
+        }
+        c = std::cin.rdbuf()->snextc();
+    }
+    if (c == '\n') {
+        std::cin.rdbuf()->sbumpc(); // Consume the line break as well
+    }
+    while (len > 0 && isspace((unsigned char) buf[len - 1])) {
+        len--;
+    }
+    buf[len] = '\0';
+    return true;
+}
+
+bool equals_ignore_case(const char *s1, const char *s2) {
+    // The casts keep non-ASCII characters from being passed to tolower as negative numbers
+    while (*s1 != '\0' && tolower((unsigned char) *s1) == tolower((unsigned char) *s2)) {
+        s1++;
+        s2++;
+    }
+    return tolower((unsigned char) *s1) == tolower((unsigned char) *s2);
+}
+
+int parse_bet(const char *s, int &bet) {
+    /*
+    Parses a bet such as "25" or "25.0"
+    Like before, anything after the number is ignored, and decimals are only accepted if they are all zeros
+    Numbers too large to fit are clamped, which the caller reports as insufficient funds
+    */
+    bool negative = false;
+    if (*s == '+' || *s == '-') {
+        negative = (*s == '-');
+        s++;
+    }
+    if (*s < '0' || '9' < *s) {
+        return BET_NOT_A_NUMBER;
+    }
+
+    int value = 0;
+    while ('0' <= *s && *s <= '9') {
+        if (value < 100000000) {
+            value = 10 * value + (*s - '0');
+        }
+        s++;
+    }
+    if (*s == '.') {
+        s++;
+        while ('0' <= *s && *s <= '9') {
+            if (*s != '0') {
+                return BET_NOT_WHOLE;
+            }
+            s++;
+        }
+    }
+
+    bet = (negative) ? -value : value;
+    return BET_OK;
+}
 
 void get_base_bet(player &p) {
-    std::string raw_input;
+    char raw_input[INPUT_BUFFER];
     int bet;
-    float float_check;
 
     std::cout << "Player "
               << p.id 
               << ": You have $" 
               << p.bank_account 
               << " to bet from."
-              << std::endl;
+              << "\n";
     
     // Keep trying until success
     while (true) {
-        std::cin >> raw_input;  // Read input as string, and then try to parse it as an int
-        try {
-            bet = std::stoi(raw_input);         // Cast string to integer
-            float_check = std::stof(raw_input); // Cast same string to float (to check for decimal values)
-            if (bet != float_check) {
-                throw (float_check);
-            }
+        if (!read_token(raw_input)) {
+            end_of_input();
+        }
 
-        // Error handling    
-        } catch (float) {
-            std::cout << "That is not a whole number. Please try again" << std::endl;
-            continue;
-        } catch (std::invalid_argument) {
-            std::cout << "That is not a number. Please try again" << std::endl;
-            continue;
+        // Read input as text, and then try to parse it as an int
+        switch (parse_bet(raw_input, bet)) {
+            case BET_NOT_WHOLE:
+                std::cout << "That is not a whole number. Please try again\n";
+                continue;
+            case BET_NOT_A_NUMBER:
+                std::cout << "That is not a number. Please try again\n";
+                continue;
         }
 
         // Bet is valid. Update numbers
@@ -111,11 +277,11 @@ void get_base_bet(player &p) {
 
         // More error handling
         } else if (bet <= 0) {
-            std::cout << "Bet must be nonnegative. Please try again" << std::endl;
+            std::cout << "Bet must be nonnegative. Please try again\n";
         } else if (bet > p.bank_account) {
-            std::cout << "Insufficient funds. Please try again" << std::endl;
+            std::cout << "Insufficient funds. Please try again\n";
         } else {
-            std::cout << "Invalid input. Please try again" << std::endl;
+            std::cout << "Invalid input. Please try again\n";
         }
     }
 }
@@ -123,6 +289,7 @@ void get_base_bet(player &p) {
 void increase_bet(player &p, int hand_id) {
     p.bet_list[hand_id] += p.base_bet;
     p.bank_account      -= p.base_bet;
+    checkpoint();   // Money on the table is saved as lost, so quitting cannot take the bet back
 }
 
 int get_card_value(card c, int score) {
@@ -141,7 +308,7 @@ int get_card_value(card c, int score) {
     }
 }
 
-int get_hand_value(hand h) {
+int get_hand_value(const hand &h) {
     int hand_val = 0;
     for (int i = 0; i < h.n_non_aces; i++) {
         hand_val += get_card_value(h.non_aces[i], hand_val);
@@ -213,10 +380,10 @@ void print_card(card c, bool capitalized) {
     print_card_suit(c);
 }
 
-void print_deck(card_deck deck){
+void print_deck(const card_deck &deck){
     for (int i = 0; i < N_CARDS; i++) {
         print_card(deck.cards[i], true);
-        std::cout << std::endl;
+        std::cout << "\n";
     }
 }
 
@@ -242,6 +409,8 @@ void swap_cards(card &c1, card &c2) {
 void reset_scores(player players[5]) {
     for (int i = 0; i < 5; i++) {
         players[i].base_bet = 0;
+        players[i].insurance_bet = 0;
+        players[i].took_even_money = false;
         for (int j = 0; j < 16; j++) {
             players[i].hand_values[j] = 0;
             players[i].bet_list[j] = 0;
@@ -264,8 +433,8 @@ card draw_card(card_deck &deck) {
         deck.top_card++;
         return drawn_card;
     } else {
-        std::cout << "The dealer has run out of cards... Wow..." << std::endl;
-        std::cout << "They pull out and shuffle a brand new deck of cards." << std::endl;
+        std::cout << "The dealer has run out of cards... Wow...\n";
+        std::cout << "They pull out and shuffle a brand new deck of cards.\n";
         /*
         Shuffling the deck this way makes it possible for a player to do more than 15 splits... 
         I can't be bothered to deal with this right now.. It is simply too pathological of an edge case
@@ -376,11 +545,13 @@ void rig_deck(card_deck &deck, int type) {
 }
 
 int get_n_players(void) {
-    char inp;
-    std::cout << "Please enter the number of players (1-4) or enter \'q\' to quit." << std::endl;
+    char inp[INPUT_BUFFER];
+    std::cout << "Please enter the number of players (1-4) or enter \'q\' to quit.\n";
     while (true) { // Keep trying until valid input is entered
-        std::cin >> inp; // Read input from user
-        switch (inp) {
+        if (!read_token(inp)) { // Read input from user
+            return 0;           // Nothing left to read also quits the program
+        }
+        switch ((inp[1] == '\0') ? inp[0] : '\0') { // Only single characters are valid
             case '1':
                 return 1;
             case '2':
@@ -393,19 +564,38 @@ int get_n_players(void) {
             case 'q':
                 return 0; // 0 quits the program
             default:
-                std::cout << "Invalid input. Please try again." << std::endl;
-                std::cout << "Enter a number (1-4) or enter \'q\' to quit." << std::endl;
+                std::cout << "Invalid input. Please try again.\n";
+                std::cout << "Enter a number (1-4) or enter \'q\' to quit.\n";
         }
     }
 }
 
 
+void print_legal_moves(const char *move_names[], bool is_move_legal[], int num_moves, int num_legal_moves) {
+    // Prints e.g. You can "Hit", "Stand", or "Surrender"
+    int moves_printed = 0;
+    std::cout << "You can ";
+    for (int i = 0; i < num_moves; i++) {
+        if (!is_move_legal[i]) {
+            continue;
+        }
+        if (moves_printed > 0) {
+            std::cout << ", ";
+            if (moves_printed == num_legal_moves - 1) {
+                std::cout << "or ";
+            }
+        }
+        std::cout << "\"" << move_names[i] << "\"";
+        moves_printed++;
+    }
+    std::cout << "\n";
+}
+
 int get_next_move(player &p, int cards_in_turn, int current_score, bool ace_split) {
     if (!p.isDealer) {
         bool is_move_legal[4] = {false, true, false, false};
         int num_legal_moves = 1;
-        int moves_counted = 0;
-        std::string move_names[4] = {"Hit",
+        static const char *move_names[4] = {"Hit",
                                      "Stand",
                                      "Double down",
                                      "Surrender"};
@@ -424,56 +614,31 @@ int get_next_move(player &p, int cards_in_turn, int current_score, bool ace_spli
             num_legal_moves++;
         }
 
-        
-        std::string legal_moves_string = "You can \"";
-        for (int i = 0; i < num_moves; i++) {
-            if (moves_counted == num_legal_moves - 1) {
-                legal_moves_string = legal_moves_string.substr(0,legal_moves_string.length() - 1);
-                legal_moves_string += "or \"";
-            }
-            moves_counted++;
-            if (is_move_legal[i]) {
-                legal_moves_string += move_names[i];
-                if (moves_counted < num_legal_moves) {
-                    legal_moves_string += "\", \"";
-                }
-            }
 
-        }
-        legal_moves_string += "\"";
+        std::cout << "You are currently at " << current_score << "\n";
+        std::cout << "What would you like to do?\n";
 
-        std::cout << "You are currently at " << current_score << std::endl;
-        std::cout << "What would you like to do?" << std::endl;
-
-        std::string inp;
+        char inp[INPUT_BUFFER];
         bool error_given;
         while (true) {
             error_given = false;
-            std::cout << legal_moves_string << std::endl;
-            std::getline(std::cin >> std::ws, inp);
-            
-            // Make the strings lowercase for easier comparison
-            std::string s1 = inp;
-            for (int i = 0; i < s1.length(); i++) {
-                s1[i] = tolower(s1[i]);
+            print_legal_moves(move_names, is_move_legal, num_moves, num_legal_moves);
+            if (!read_line(inp)) {
+                end_of_input();
             }
             
             for (int move_id = 0; move_id < num_moves; move_id++) {
-                std::string s2 = move_names[move_id];
-                for (int i = 0; i < s2.length(); i++) {
-                    s2[i] = tolower(s2[i]);
-                }
-                if (s1 == s2) {
+                if (equals_ignore_case(inp, move_names[move_id])) {
                     if (is_move_legal[move_id]) {
                         return move_id;
                     } else {
-                        std::cout << "That move is not legal at the moment. Try again" << std::endl;
+                        std::cout << "That move is not legal at the moment. Try again\n";
                         error_given = true;
                     }
                 }
             }
             if (!error_given) {
-                std::cout << "Invalid input. Try again" << std::endl;
+                std::cout << "Invalid input. Try again\n";
                 error_given = true;
             }
         }
@@ -508,17 +673,19 @@ bool top_draw_blackjack(card c1, card c2) {
 }
 
 bool yes_or_no(void) {
-    char inp;
+    char inp[INPUT_BUFFER];
     while (true) { // Keep trying until valid input is entered
-        std::cin >> inp; // Read input from user
-        switch (inp) {
+        if (!read_token(inp)) { // Read input from user
+            end_of_input();
+        }
+        switch ((inp[1] == '\0') ? inp[0] : '\0') { // Only single characters are valid
             case 'y':
                 return true;
             case 'n':
                 return false;
             default:
-                std::cout << "Invalid input. Please try again." << std::endl;
-                std::cout << "\'y\' for yes, \'n\' for no." << std::endl;
+                std::cout << "Invalid input. Please try again.\n";
+                std::cout << "\'y\' for yes, \'n\' for no.\n";
         }
     }
 }
@@ -558,28 +725,28 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
                   << ((card2.val == 12) ? "an " : "a ");
                        print_card(card2, false);
         std::cout << "."
-                  << std::endl;
+                  << "\n";
 
         // Print out dealer's top card
         std::cout << "The dealer has "
                   << ((dealer.starting_hand[0].val == 12) ? "an " : "a ");
                        print_card(dealer.starting_hand[0], false);
         std::cout << " face up."
-                  << std::endl;
+                  << "\n";
 
         // If the first two cards are the same, splitting is an option (Provided there is enough bank balance)
         if (card1.val == card2.val || (is_face_card(card1) && is_face_card(card2))) {
             if (p.bank_account > p.base_bet) {
 
                 std::cout << "Would you like to split your two cards (y/n)"
-                            << std::endl;
+                            << "\n";
                 std::cout << "It will cost another bet of $"
                             << p.base_bet
                             << ". ";
                 std::cout << "You have $"
                             << p.bank_account
                             << " in your account."
-                            << std::endl;
+                            << "\n";
 
                 if (yes_or_no()) {
                     bool is_ace_split = false;
@@ -599,7 +766,7 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
                     return;
                 }
             } else { // There is a split, but funds are insufficient
-                std::cout << "You do not have enough money to place another bet for a split." << std::endl;
+                std::cout << "You do not have enough money to place another bet for a split.\n";
             }
         }
     } else {
@@ -611,14 +778,14 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
                   << ((card2.val == 12) ? "an " : "a ");
                        print_card(card2, false);
         std::cout << "."
-                  << std::endl;
+                  << "\n";
     }
 
     // First check if there is blackjack, and proceed if so
     if (top_draw_blackjack(card1,card2)) {
         std::cout << "That's a blackjack! "
                   << ((p.isDealer) ? "The house wins." : "Lucky you.")
-                  << std::endl;
+                  << "\n";
         current_score = BLACKJACK;
         p.hand_values[hand_id] = current_score;
         return;
@@ -641,13 +808,13 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
             std::cout << ((p.isDealer) ? "They" : "You")
                         << " hit 21. "
                         << ((p.isDealer) ? "Oof!" : "Nice!")
-                        << std::endl;
+                        << "\n";
             p.hand_values[hand_id] = current_score;
             is_done = true;
         } else if (current_score > 21) {
             std::cout << ((p.isDealer) ? "They" : "You")
                         << " have busted."
-                        << std::endl;
+                        << "\n";
             current_score = BUSTED;
             p.hand_values[hand_id] = current_score;             
             is_done = true;
@@ -670,7 +837,7 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
                             << ((new_card.val == 12) ? "an " : "a ");
                                 print_card(new_card,false);
                 std::cout << "."
-                            << std::endl;
+                            << "\n";
                 
                 break;
 
@@ -690,7 +857,7 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
                             << ((new_card.val == 12) ? "an " : "a ");
                                 print_card(new_card,false);
                 std::cout << "."
-                            << std::endl;
+                            << "\n";
 
                 is_done = true;
                 break;
@@ -708,28 +875,157 @@ void play_round(player &dealer, player &p, card_deck &deck, card card1, card car
 }
 // Now we overload it
 void play_round(player &dealer, player &p, card_deck &deck) {
-    std::cout << ((p.isDealer) ? "Dealer\'s" : ("Player " + std::to_string(p.id) + "\'s")) << " turn." << std::endl;
+    if (p.hand_values[0] != 0) {
+        return; // The hand was settled before the turns started (even money or a dealer blackjack)
+    }
+    if (p.isDealer) {
+        std::cout << "Dealer\'s turn.\n";
+    } else {
+        std::cout << "Player " << p.id << "\'s turn.\n";
+    }
     play_round(dealer, p, deck, p.starting_hand[0], p.starting_hand[1], false);
 }
 
+/*
+When the dealer shows an ace, a player can insure against a dealer blackjack.
+Insurance costs half the base bet and pays 2 to 1.
+A player who has a blackjack is instead offered even money: their bet is paid 1 to 1 right away
+*/
+void offer_insurance(player &p) {
+    std::cout << "Player "
+              << p.id
+              << ": You got "
+              << ((p.starting_hand[0].val == 12) ? "an " : "a ");
+                   print_card(p.starting_hand[0], false);
+    std::cout << " and "
+              << ((p.starting_hand[1].val == 12) ? "an " : "a ");
+                   print_card(p.starting_hand[1], false);
+    std::cout << ". The dealer has an ace face up.\n";
+
+    if (top_draw_blackjack(p.starting_hand[0], p.starting_hand[1])) {
+        std::cout << "You have a blackjack. Would you like to take even money (y/n)\n";
+        if (yes_or_no()) {
+            increase_bet(p, 0);
+            p.bank_account += 2 * p.bet_list[0];
+            p.bet_list[0] = 0;              // The bet has been paid, so there is nothing left to resolve
+            p.hand_values[0] = BLACKJACK;
+            p.took_even_money = true;
+            checkpoint();
+            std::cout << "You are paid $" << p.base_bet << ".\n";
+        }
+        return;
+    }
+
+    int cost = p.base_bet / 2;
+    if (cost == 0 || p.bank_account - p.base_bet < cost) { // The base bet has not been taken from the account yet
+        return;
+    }
+    std::cout << "Would you like insurance (y/n)\n";
+    std::cout << "It will cost $"
+              << cost
+              << " and pays 2 to 1 if the dealer has a blackjack.\n";
+    if (yes_or_no()) {
+        p.insurance_bet = cost;
+        p.bank_account -= cost;
+        checkpoint();
+    }
+}
+
+/*
+With an ace or a ten-value card face up, the dealer checks their hole card for a blackjack.
+If they have one, the round ends before anyone takes their turn: every open hand loses, unless it is a blackjack itself.
+Returns true if the dealer has a blackjack
+*/
+bool dealer_peek(player players[5], int n_players) {
+    player &dealer = players[0];
+    card up_card = dealer.starting_hand[0];
+    if (up_card.val != 12 && !is_face_card(up_card)) {
+        return false;
+    }
+
+    if (!top_draw_blackjack(dealer.starting_hand[0], dealer.starting_hand[1])) {
+        std::cout << "The dealer peeks at their hole card. No blackjack.\n";
+        return false;
+    }
+
+    std::cout << "The dealer has "
+              << ((up_card.val == 12) ? "an " : "a ");
+                   print_card(up_card, false);
+    std::cout << " face up. They peek at their hole card, and turn over "
+              << ((dealer.starting_hand[1].val == 12) ? "an " : "a ");
+                   print_card(dealer.starting_hand[1], false);
+    std::cout << ". That's a blackjack! The house wins.\n";
+    dealer.hand_values[0] = BLACKJACK;
+
+    for (int p_id = n_players; p_id > 0; p_id--) {
+        player &p = players[p_id];
+        if (p.hand_values[0] != 0) {
+            continue; // Already took even money
+        }
+        std::cout << "Player "
+                  << p.id
+                  << ": You got "
+                  << ((p.starting_hand[0].val == 12) ? "an " : "a ");
+                       print_card(p.starting_hand[0], false);
+        std::cout << " and "
+                  << ((p.starting_hand[1].val == 12) ? "an " : "a ");
+                       print_card(p.starting_hand[1], false);
+        std::cout << ".\n";
+        increase_bet(p, 0);
+        if (top_draw_blackjack(p.starting_hand[0], p.starting_hand[1])) {
+            p.hand_values[0] = BLACKJACK;
+        } else {
+            hand h;
+            add_to_hand(h, p.starting_hand[0]);
+            add_to_hand(h, p.starting_hand[1]);
+            p.hand_values[0] = get_hand_value(h);
+        }
+    }
+    return true;
+}
+
 void resolve_round(player players[5], int n_players) {
     for (int p_id = n_players ; p_id >= 0; p_id--) {
         std::cout << "Player " << p_id << ": ";
         for (int hand = 0; hand < 16; hand++) {
             std::cout << players[p_id].hand_values[hand] << ",\t";
         }
-        std::cout << std::endl;
+        std::cout << "\n";
     }
 
-    std::cout << "== Comparing hands== " << std::endl;
+    std::cout << "== Comparing hands== \n";
     if (players[0].hand_values[0] == BLACKJACK) {
-        std::cout << "The dealer has a blackjack" << std::endl;
+        std::cout << "The dealer has a blackjack\n";
+    }
+    for (int p_id = n_players; p_id > 0; p_id--) {
+        if (players[p_id].insurance_bet > 0) {
+            if (players[0].hand_values[0] == BLACKJACK) {
+                players[p_id].bank_account += 3 * players[p_id].insurance_bet;
+                std::cout << "Player "
+                          << p_id
+                          << ": Your insurance pays $"
+                          << 2 * players[p_id].insurance_bet
+                          << ".\n";
+            } else {
+                std::cout << "Player "
+                          << p_id
+                          << ": Your insurance of $"
+                          << players[p_id].insurance_bet
+                          << " is lost.\n";
+            }
+        }
     }
     for (int p_id = n_players ; p_id > 0; p_id--) {
         int wins = 0;
         int loss = 0;
         int ties = 0;
         for (int hand = 0; hand < 16; hand++) {
+            if (hand == 0 && players[p_id].took_even_money) {
+                std::cout << "Player "
+                          << p_id
+                          << ": Your blackjack was already paid even money.\n";
+                continue;
+            }
             if (players[p_id].hand_values[hand] != 0) {
                 if (players[p_id].hand_values[hand] > players[0].hand_values[0]) {
                     wins++;
@@ -754,11 +1050,11 @@ void resolve_round(player players[5], int n_players) {
                           << p_id 
                           << ": You have a hand ";
                 if (players[p_id].hand_values[hand] == BUSTED) {
-                    std::cout << "that busted!" << std::endl;
+                    std::cout << "that busted!\n";
                 } else {
                     std::cout << "of " 
                               << players[p_id].hand_values[hand]
-                              << std::endl;
+                              << "\n";
                 }
 
                 */
@@ -777,16 +1073,105 @@ void resolve_round(player players[5], int n_players) {
               << "and "
               << ties
               << " ties.\n"
-              << std::endl;
+              << "\n";
 
     }
 }
 
+/*
+Writes a checkpoint of the game to SAVE_FILE, so the game can be resumed if it gets interrupted.
+The seed and the round number are enough to recreate the shuffles, since every round reseeds with seed + round.
+Every bet in the round being played is saved as already lost: base bets that are not on the table yet are subtracted
+here, and the game is checkpointed again every time more money goes on the table (doubling down, splitting, insurance).
+Together with saving the next round number before the cards are dealt, this means an interrupted round is burned:
+quitting and resuming neither reveals the cards of a round in advance nor takes back a bad hand.
+The file is written to a temporary file first and then renamed, so a half-written save never replaces a good one
+*/
+void save_game(player players[5], unsigned int seed, int round) {
+    const char *tmp_name = SAVE_FILE ".tmp";
+    std::ofstream out(tmp_name);
+    if (!out) {
+        std::cout << "Could not save the game.\n";
+        return;
+    }
+
+    out << SAVE_VERSION << " " << seed << " " << round << "\n";
+    for (int i = 1; i < 5; i++) { // The dealer has no bank account worth saving
+        bool bet_on_table = players[i].bet_list[0] != 0 || players[i].hand_values[0] != 0;
+        out << players[i].bank_account - ((bet_on_table) ? 0 : players[i].base_bet) << "\n";
+    }
+    out.close();
+
+    if (!out || std::rename(tmp_name, SAVE_FILE) != 0) {
+        std::cout << "Could not save the game.\n";
+        std::remove(tmp_name);
+    }
+}
+
+void checkpoint(void) {
+    if (save_players != nullptr) {
+        save_game(save_players, save_seed, save_round);
+    }
+}
+
+/*
+Reads a checkpoint written by save_game
+Returns false (and leaves everything untouched) if there is no save, or if it is from another version or damaged
+*/
+bool load_game(player players[5], unsigned int &seed, int &round) {
+    std::ifstream in(SAVE_FILE);
+    if (!in) {
+        return false;
+    }
+
+    int version;
+    unsigned int saved_seed;
+    int saved_round;
+    int bank_accounts[5];
+    in >> version >> saved_seed >> saved_round;
+    for (int i = 1; i < 5; i++) {
+        in >> bank_accounts[i];
+        if (bank_accounts[i] < 0 || bank_accounts[i] > MAX_SAVED_BANK_ACCOUNT) {
+            in.setstate(std::ios::failbit); // Nobody can have won that much, so the file has been tampered with
+        }
+    }
+    if (!in || version != SAVE_VERSION || saved_round < 0) {
+        std::cout << "The saved game could not be read, so a new game is started.\n";
+        return false;
+    }
+
+    seed  = saved_seed;
+    round = saved_round;
+    for (int i = 1; i < 5; i++) {
+        players[i].bank_account = bank_accounts[i];
+    }
+    return true;
+}
+
 
 int main(void) {
 
     // Game setup
-    srand(time(0)); // Set the seed for the random number generator
+    std::ios::sync_with_stdio(false); // All output goes through std::cout, so C stdio does not need to keep up
+    bool scripted = !isatty(STDIN_FILENO); // Decisions are piped in from a script instead of typed
+    if (scripted) {
+        // Nobody is waiting on the prompts, so stop flushing before every read
+        std::cin.tie(nullptr);
+    }
+    unsigned int seed = time(0); // The seed for the random number generator
+    int round = 0;               // Number of rounds played so far
+
+    // A fixed seed can be given in BLACKJACK_SEED, so a script can be written against a known deal
+    const char *seed_env = std::getenv("BLACKJACK_SEED");
+    if (seed_env != nullptr) {
+        char *end;
+        unsigned long fixed_seed = std::strtoul(seed_env, &end, 10);
+        if (*seed_env != '\0' && *end == '\0') {
+            seed = fixed_seed;
+        } else {
+            std::cout << "BLACKJACK_SEED is not a number, so a random seed is used.\n";
+        }
+    }
 
     // Create the deck of cards
     card_deck deck;
@@ -796,7 +1181,22 @@ int main(void) {
     player players[5];
     player_init(players);
 
-    std::cout << "Welcome to Blackjack!" << std::endl;
+    std::cout << "Welcome to Blackjack!\n";
+
+    // Offer to pick up where a previous game left off
+    // Scripted games neither load nor save, so with a fixed BLACKJACK_SEED a script plays out the same way every time it is run
+    std::ifstream save_check(SAVE_FILE);
+    if (!scripted && save_check) {
+        save_check.close();
+        std::cout << "A saved game was found. Would you like to resume it (y/n)\n";
+        if (yes_or_no() && load_game(players, seed, round)) {
+            std::cout << "Resuming from round " << round + 1 << ".\n";
+        }
+    }
+    if (!scripted) {
+        save_players = players;
+        save_seed = seed;
+    }
 
 
     while (true) { // Main loop
@@ -807,8 +1207,12 @@ int main(void) {
         if (n_players == 0) { // The player wants to quit the game
             break;
         }
+#ifdef COUNT_ALLOCATIONS
+        long allocations_before_round = n_allocations;
+#endif
 
         // Get the game state ready
+        srand(seed + round); // Reseed every round so a resumed game shuffles exactly like the original
         deck_shuffle(deck);
         //rig_deck(deck, 1);
         //print_deck(deck);
@@ -818,6 +1222,11 @@ int main(void) {
         for (int turn=n_players; turn >= 1; turn--) {
             get_base_bet(players[turn]);
         }
+
+        // Checkpoint before the cards are dealt, with the bets counted as lost, so the round is burned if the game is interrupted
+        round++;
+        save_round = round;
+        checkpoint();
         
         // Second, everyone gets dealt two cards
         for (int turn=n_players; turn >= 0; turn--) {
@@ -825,14 +1234,29 @@ int main(void) {
             players[turn].starting_hand[1] = draw_card(deck);
         }
 
+        // If the dealer shows an ace, players may insure against a blackjack
+        if (players[0].starting_hand[0].val == 12) {
+            for (int turn=n_players; turn >= 1; turn--) {
+                offer_insurance(players[turn]);
+            }
+        }
+
         // Third everyone takes their turn. Dealer goes last
-        for (int turn=n_players; turn >= 0; turn--) {
-            play_round(players[0], players[turn], deck);
+        // If the dealer peeks and finds a blackjack, there is nothing left to play
+        if (!dealer_peek(players, n_players)) {
+            for (int turn=n_players; turn >= 0; turn--) {
+                play_round(players[0], players[turn], deck);
+            }
         }
 
         // Finally, showdown.
         resolve_round(players, n_players);
 
+        // Checkpoint the settled round, so an interrupted game does not lose its progress
+        checkpoint();
+#ifdef COUNT_ALLOCATIONS
+        std::cout << "Heap allocations this round: " << n_allocations - allocations_before_round << "\n";
+#endif
 
     }
 